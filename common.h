@@ -9,15 +9,18 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/select.h>
 #include <netinet/in.h>
 
@@ -32,11 +35,28 @@
 #define UPDATE_INTERVAL_SEC 5 // Periodic routing update interval (seconds)
 #define DEAD_INTERVAL_SEC 15  // Time to mark neighbor dead if no updates
 #define DATA_PORT_OFFSET 1000 // Data sockets use (control_port + offset)
+#define MAX_SUBS 8            // Maximum number of route-event subscribers
+#define CAP_BUF_SIZE (256*1024) // Packet capture buffer, flushed off the hot path
+#define CTRL_BATCH_MAX 1024   // Control messages read per socket per batch
+#define RTT_EWMA_SHIFT 3      // Smoothed RTT gain 1/8 (srtt += (rtt - srtt) / 8)
+
+// Route flap dampening ("dampening on"), after RFC 2439
+#define DAMP_PENALTY_WITHDRAW 1000  // Added when a route becomes unreachable
+#define DAMP_PENALTY_CHANGE   500   // Added when a route moves to another next hop
+#define DAMP_SUPPRESS 2000    // Penalty at which a route is suppressed
+#define DAMP_REUSE    750     // Penalty below which it is used again
+#define DAMP_MAX      6000    // Penalty ceiling (bounds time spent suppressed)
+#define DAMP_DECAY_Q16 64783  // Per-second decay, 2^(-1/60) in Q16: 60 s half-life,
+                              // long against DEAD_INTERVAL_SEC so a neighbor that
+                              // dies every dead interval is suppressed on the 3rd flap
 
 // -----------------------------------------------------------------------------
 // Message type identifiers
 // -----------------------------------------------------------------------------
-enum { MSG_DV = 2, MSG_DATA = 3 };
+enum { MSG_DV = 2, MSG_DATA = 3, MSG_PROBE = 4, MSG_PROBE_REPLY = 5 };
+
+// Route-change event types (see route_event_t)
+enum { EV_ADD = 1, EV_MODIFY = 2, EV_WITHDRAW = 3, EV_SNAP_BEGIN = 4, EV_SNAP_END = 5 };
 
 // -----------------------------------------------------------------------------
 // Notes about #pragma pack(push,1) / #pragma pack(pop)
@@ -108,15 +128,87 @@ typedef struct {
     uint16_t payload_len;
     char     payload[128];
 } data_msg_t;
+
+// -----------------------------------------------------------------------------
+// Link probe format (RTT measurement between neighbors, "link_metric rtt")
+// -----------------------------------------------------------------------------
+// A router sends MSG_PROBE to each neighbor's control port once per second;
+// the neighbor returns it unchanged except for type=MSG_PROBE_REPLY. sent_ns is
+// only interpreted by the prober, so it stays in host byte order.
+//
+typedef struct {
+    uint8_t  type;       // MSG_PROBE or MSG_PROBE_REPLY
+    uint16_t sender_id;  // Router ID of the prober (NBO)
+    uint64_t sent_ns;    // Prober's CLOCK_MONOTONIC send time, echoed back
+} probe_msg_t;
+
+// -----------------------------------------------------------------------------
+// Route-change event record (published on the local event socket)
+// -----------------------------------------------------------------------------
+// One record per SOCK_SEQPACKET message. A route is "present" while its cost is
+// below INF_COST: EV_ADD when it becomes reachable, EV_MODIFY when next hop
+// (ip or port) or cost changes, EV_WITHDRAW when it becomes unreachable.
+//
+// On connect a subscriber first receives a snapshot:
+//
+//   EV_SNAP_BEGIN(seq=S), EV_ADD(seq=S) for every present route, EV_SNAP_END(seq=S)
+//
+// followed by live events numbered S+1, S+2, ... A gap in seq means records
+// were lost; the subscriber reconnects and resyncs from a fresh snapshot.
+//
+typedef struct {
+    uint8_t  type;       // EV_* record type
+    uint32_t seq;        // Monotonic event sequence number (NBO)
+    uint32_t net;        // Destination network (NBO)
+    uint32_t mask;       // Subnet mask (NBO)
+    uint32_t next_hop;   // Next hop IP (NBO)
+    uint16_t cost;       // New cost (NBO), INF_COST for EV_WITHDRAW
+    uint16_t nh_port;    // Next hop router's control port (NBO), 0 for local routes
+} route_event_t;
+
+// -----------------------------------------------------------------------------
+// Packet capture file format (classic pcap, host byte order)
+// -----------------------------------------------------------------------------
+// The router's "capture <path>" option writes every received data_msg_t as one
+// record, exactly as it arrived on the data socket. The link type is USER0 so
+// Wireshark/tcpdump can read the file; replay.c sends it back to a router.
+//
+//   +-------------+------------------+-------+------------------+-------+---
+//   |pcap_hdr_t   |pcap_rec_t        |bytes  |pcap_rec_t        |bytes  |...
+//   +-------------+------------------+-------+------------------+-------+---
+//
+#define PCAP_MAGIC   0xa1b2c3d4u  // Microsecond timestamps
+#define PCAP_LINKTYPE 147         // LINKTYPE_USER0: raw data_msg_t
+
+typedef struct {
+    uint32_t magic;      // PCAP_MAGIC
+    uint16_t ver_major;  // 2
+    uint16_t ver_minor;  // 4
+    int32_t  thiszone;   // GMT offset, always 0
+    uint32_t sigfigs;    // Timestamp accuracy, always 0
+    uint32_t snaplen;    // Largest record: sizeof(data_msg_t)
+    uint32_t linktype;   // PCAP_LINKTYPE
+} pcap_hdr_t;
+
+typedef struct {
+    uint32_t ts_sec;     // Receive time (seconds since epoch)
+    uint32_t ts_usec;    // Receive time (microseconds)
+    uint32_t incl_len;   // Bytes stored in the file
+    uint32_t orig_len;   // Bytes received from the socket
+} pcap_rec_t;
 #pragma pack(pop)
 
 // -----------------------------------------------------------------------------
 // Neighbor state: information about directly connected routers
 // -----------------------------------------------------------------------------
 typedef struct {
-    uint32_t ip;         // Neighbor's IP address (NBO, loopback used here)
+    uint32_t ip;         // Neighbor's IP address (NBO); (ip, ctrl_port) is the key
     uint16_t ctrl_port;  // UDP port used for control messages (DV)
-    uint16_t cost;       // Link cost to this neighbor
+    int      sock_ctrl;  // Control socket connect()ed to this neighbor
+    int      sock_data;  // Data socket connect()ed to this neighbor's data port
+    uint16_t cost;       // Link cost to this neighbor (used by dv_update)
+    uint16_t base_cost;  // Link cost from the config file
+    uint32_t srtt_us;    // Smoothed RTT in microseconds (0 = no sample yet)
     time_t   last_heard; // Last time a DV was received
     bool     alive;      // True if neighbor is still reachable
 } neighbor_t;
@@ -128,9 +220,15 @@ typedef struct {
     uint32_t dest_net;   // Destination network (NBO)
     uint32_t mask;       // Subnet mask (NBO)
     uint32_t next_hop;   // Next hop IP (0 for directly connected networks)
+    uint16_t nh_port;    // Next hop control port (0 = any neighbor at next_hop)
     char     iface[8];   // Optional interface name string
     uint16_t cost;       // Path cost metric (0 = local, 1+ = learned)
     time_t   last_update;// Timestamp of last DV update for this route
+    bool     local;      // From the config file: never replaced by DV
+    bool     reachable;  // Best path before dampening was usable (flap tracking)
+    bool     suppressed; // Dampened: advertised and installed as INF_COST
+    uint16_t penalty;    // Flap penalty, decays with DAMP_DECAY_Q16
+    uint16_t adv[MAX_NEIGH]; // Cost advertised by each neighbor (INF_COST = none)
 } route_entry_t;
 
 // -----------------------------------------------------------------------------
@@ -144,6 +242,34 @@ typedef struct {
     int sock_ctrl;             // Socket for control (DV) messages
     int sock_data;             // Socket for data packets
 
+    char ev_path[108];         // Unix socket path for route events ("" = off)
+    int sock_ev;               // Listening socket for route events (-1 = off)
+    uint32_t ev_seq;           // Sequence number of the last published event
+    int num_subs;              // Number of connected event subscribers
+    int subs[MAX_SUBS];
+
+    char cap_path[108];        // Packet capture file ("" = off)
+    int cap_fd;                // Capture file descriptor (-1 = off)
+    uint8_t* cap_buf;          // Pending capture records (CAP_BUF_SIZE bytes)
+    size_t cap_len;            // Bytes pending in cap_buf
+    uint32_t cap_drops;        // Records dropped because cap_buf was full
+
+    time_t next_broadcast;     // Time of the next periodic DV broadcast
+    time_t last_cap_flush;     // Time cap_buf was last written out
+    bool use_uring;            // "io_backend uring" requested in config
+    struct uring_io* uring;    // io_uring backend state (NULL = select backend)
+
+    const char* pending_log;   // log_table() tag for the pending rt_recompute() (NULL = none)
+
+    uint32_t rtt_unit_us;      // "link_metric rtt": RTT per extra cost unit (0 = static)
+    time_t last_probe;         // Time link probes were last sent
+
+    bool damp_on;              // "dampening on": suppress flapping routes
+    time_t last_decay;         // Time flap penalties were last decayed
+    int damp_suppressed;       // Routes currently suppressed
+    uint32_t damp_flaps;       // Flaps counted since startup
+    uint32_t damp_suppress_total; // Times any route was suppressed since startup
+
     int num_neighbors;         // Number of directly connected neighbors
     neighbor_t neighbors[MAX_NEIGH];
 
@@ -182,15 +308,58 @@ static inline route_entry_t* rt_find_or_add(router_t* r, uint32_t net, uint32_t
 
     if (r->num_routes >= MAX_DEST) return NULL;
 
-    r->routes[r->num_routes] = (route_entry_t){
+    route_entry_t* e = &r->routes[r->num_routes++];
+    *e = (route_entry_t){
         .dest_net = net,
         .mask = mask,
         .next_hop = 0,
+        .nh_port = 0,
         .iface = "",
         .cost = INF_COST,
         .last_update = time(NULL)
     };
-    return &r->routes[r->num_routes++];
+    for (int i = 0; i < MAX_NEIGH; i++) e->adv[i] = INF_COST;
+    return e;
+}
+
+// -----------------------------------------------------------------------------
+// Find the neighbor with the given IP and control port (NBO ip, host-order port).
+// port 0 matches any neighbor at that IP. Returns NULL if there is none.
+// -----------------------------------------------------------------------------
+static inline neighbor_t* nb_find(router_t* r, uint32_t ip, uint16_t port){
+    for (int i = 0; i < r->num_neighbors; i++)
+        if (r->neighbors[i].ip == ip && (!port || r->neighbors[i].ctrl_port == port))
+            return &r->neighbors[i];
+    return NULL;
+}
+
+// True if route e was learned from (uses) neighbor nb
+static inline bool rt_via(const route_entry_t* e, const neighbor_t* nb){
+    return e->next_hop == nb->ip && (!e->nh_port || e->nh_port == nb->ctrl_port);
+}
+
+// -----------------------------------------------------------------------------
+// Parse a router address given as "port" (loopback) or "ip:port".
+// Used by the command-line tools. Returns false on a malformed address.
+// -----------------------------------------------------------------------------
+static inline bool parse_endpoint(const char* s, uint32_t* ip, uint16_t* port){
+    char host[64];
+    const char* colon = strrchr(s, ':');
+    *ip = htonl(INADDR_LOOPBACK);
+    if (colon) {
+        size_t n = (size_t)(colon - s);
+        if (n == 0 || n >= sizeof(host)) return false;
+        memcpy(host, s, n); host[n] = 0;
+        struct in_addr a;
+        if (!inet_aton(host, &a)) return false;
+        *ip = a.s_addr;
+        s = colon + 1;
+    }
+    char* end;
+    long p = strtol(s, &end, 10);
+    if (*s == 0 || *end || p <= 0 || p > 65535) return false;
+    *port = (uint16_t)p;
+    return true;
 }
 
 // -----------------------------------------------------------------------------
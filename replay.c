@@ -0,0 +1,94 @@
+#include "common.h"
+
+// Usage: replay [router_ip:]<router_ctrl_port> <capture.pcap> [speed|max] [loops]
+//
+// Sends every data_msg_t in a capture written by the router's "capture" option
+// to a router's data port. speed=1 keeps the original inter-packet gaps, 2 plays
+// twice as fast, 0.5 half as fast; "max" sends back-to-back with no pacing.
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t){
+    struct timespec ts = { .tv_sec = (time_t)t, .tv_nsec = (long)((t - (double)(time_t)t) * 1e9) };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+int main(int argc,char** argv){
+    if(argc<3 || argc>5){
+        fprintf(stderr,"Usage: %s [router_ip:]<router_ctrl_port> <capture.pcap> [speed|max] [loops]\n", argv[0]);
+        return 1;
+    }
+    uint32_t router_ip; uint16_t ctrl;
+    if(!parse_endpoint(argv[1], &router_ip, &ctrl)){ fprintf(stderr,"bad router address\n"); return 2; }
+    uint16_t data_port = get_data_port(ctrl);
+    double speed = 1.0;                 // 0 = maximum rate
+    if(argc>3){
+        if(!strcmp(argv[3],"max")) speed = 0.0;
+        else {
+            char* end;
+            errno = 0;
+            speed = strtod(argv[3], &end);
+            if(errno || end==argv[3] || *end || !(speed>0)){ fprintf(stderr,"bad speed: %s\n",argv[3]); return 2; }
+        }
+    }
+    long loops = 1;
+    if(argc>4){
+        char* end;
+        errno = 0;
+        loops = strtol(argv[4], &end, 10);
+        if(errno || end==argv[4] || *end || loops<1){ fprintf(stderr,"bad loops: %s\n",argv[4]); return 2; }
+    }
+
+    // Load the whole capture up front so file I/O stays out of the send loop
+    FILE* f=fopen(argv[2],"rb");
+    if(!f){ perror(argv[2]); return 2; }
+    fseek(f,0,SEEK_END); long size=ftell(f); fseek(f,0,SEEK_SET);
+    uint8_t* buf=malloc(size>0 ? (size_t)size : 1);
+    if(!buf || fread(buf,1,(size_t)size,f)!=(size_t)size){ perror("read capture"); return 2; }
+    fclose(f);
+
+    pcap_hdr_t h;
+    if((size_t)size<sizeof(h)){ fprintf(stderr,"%s: not a capture file\n",argv[2]); return 2; }
+    memcpy(&h,buf,sizeof(h));
+    if(h.magic!=PCAP_MAGIC || h.linktype!=PCAP_LINKTYPE){
+        fprintf(stderr,"%s: not a router capture (magic %08x linktype %u)\n",argv[2],h.magic,h.linktype);
+        return 2;
+    }
+
+    int s=socket(AF_INET,SOCK_DGRAM,0); if(s<0){perror("socket"); return 3;}
+    struct sockaddr_in to={0}; to.sin_family=AF_INET;
+    to.sin_addr.s_addr=router_ip;
+    to.sin_port=htons(data_port);
+    if(connect(s,(struct sockaddr*)&to,sizeof(to))<0){perror("connect"); return 3;}
+
+    unsigned long sent=0, bytes=0, errs=0;
+    double start=now_sec();
+    for(long l=0; l<loops; l++){
+        size_t off=sizeof(h);
+        double t0=0, base=now_sec();
+        bool first=true;
+        while(off+sizeof(pcap_rec_t)<=(size_t)size){
+            pcap_rec_t rec;
+            memcpy(&rec,buf+off,sizeof(rec));
+            off+=sizeof(rec);
+            if(rec.incl_len>(size_t)size-off) break;   // truncated trailing record
+
+            double ts=(double)rec.ts_sec+(double)rec.ts_usec/1e6;
+            if(first){ t0=ts; first=false; }
+            if(speed>0) sleep_until(base+(ts-t0)/speed);
+
+            if(send(s,buf+off,rec.incl_len,0)<0) errs++;
+            else { sent++; bytes+=rec.incl_len; }
+            off+=rec.incl_len;
+        }
+    }
+    double el=now_sec()-start;
+    printf("sent %lu packets (%lu bytes) in %.3f s: %.0f pkt/s, %lu errors\n",
+           sent, bytes, el, el>0 ? (double)sent/el : 0.0, errs);
+    free(buf);
+    close(s);
+    return errs ? 4 : 0;
+}
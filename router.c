@@ -1,4 +1,6 @@
 #include "common.h"
+#include "uring.h"
+#include "trace.h"
 
 /*
  * CSCI-4220: Router Simulation (Distance Vector Routing)
@@ -102,12 +104,37 @@
  * -------------------------------------------------------------------------
  * 9. No Matching Route
  * -------------------------------------------------------------------------
- * Printed when no route matches the packet’s destination (LPM lookup fails).
+ * Printed when no route matches the packet’s destination (LPM lookup fails),
+ * or the matching route is unreachable (cost 65535) via a live next hop.
  *
  * Example:
  *   [R1] NO MATCH dst=10.0.99.55
  *
  * -------------------------------------------------------------------------
+ * 10. Link Cost Change ("link_metric rtt" only)
+ * -------------------------------------------------------------------------
+ * Printed when a neighbor's measured RTT moves its link cost. If that changes
+ * any route, it is followed by log_table(&R, "link-cost"); a link no best
+ * path uses gets the LINK line alone.
+ *
+ * Example:
+ *   [R1] LINK 127.0.1.3 rtt=2150us cost 3->5
+ *
+ * -------------------------------------------------------------------------
+ * 11. Route Dampening ("dampening on" only)
+ * -------------------------------------------------------------------------
+ * Printed when a flapping route is suppressed, and when its penalty has
+ * decayed enough for it to be used again (followed by
+ * log_table(&R, "damp-reuse")). A suppressed route is not used for
+ * forwarding (NO MATCH) and is advertised at cost 65535. Counters cover all
+ * routes of this router: suppressed= routes suppressed now, suppressions=
+ * and flaps= totals since startup.
+ *
+ * Example:
+ *   [R1] DAMP suppress 10.0.20.0/255.255.255.0 penalty=2000 suppressed=1 suppressions=1 flaps=4
+ *   [R1] DAMP reuse 10.0.20.0/255.255.255.0 penalty=745 suppressed=0 suppressions=1 flaps=4
+ *
+ * -------------------------------------------------------------------------
  * Summary
  * -------------------------------------------------------------------------
  * | Event              | Tag               | Example                                    |
@@ -121,6 +148,8 @@
  * | TTL Expired        | DROP ttl=0        | [R2] DROP ttl=0                            |
  * | Next Hop Down      | NEXT HOP DOWN     | [R1] NEXT HOP DOWN ...                     |
  * | No Route           | NO MATCH          | [R1] NO MATCH dst=...                      |
+ * | Link Cost Change   | (link-cost)       | [R1] LINK 127.0.1.3 rtt=...                |
+ * | Route Dampening    | DAMP              | [R1] DAMP suppress 10.0.20.0/...           |
  *
  * -------------------------------------------------------------------------
  * Notes:
@@ -138,7 +167,8 @@ static void trim(char* s){
 }
 
 /* -------------------------------------------------------------------------
- * Parse router configuration file (router_id, self_ip, routes, neighbors)
+ * Parse router configuration file (router_id, self_ip, routes, neighbors,
+ * optional event_socket, capture, io_backend, link_metric and dampening)
  * ------------------------------------------------------------------------- */
 static void parse_conf(router_t* R, const char* path){
     FILE* f=fopen(path,"r");
@@ -167,6 +197,46 @@ static void parse_conf(router_t* R, const char* path){
             R->ctrl_port=(uint16_t)p; continue;
         }
 
+        if(!strncmp(line,"event_socket",12)){
+            char path[sizeof(R->ev_path)];
+            if(sscanf(line,"event_socket %107s", path)!=1) die("bad event_socket");
+            snprintf(R->ev_path,sizeof(R->ev_path),"%s",path);
+            continue;
+        }
+
+        if(!strncmp(line,"capture",7)){
+            char path[sizeof(R->cap_path)];
+            if(sscanf(line,"capture %107s", path)!=1) die("bad capture");
+            snprintf(R->cap_path,sizeof(R->cap_path),"%s",path);
+            continue;
+        }
+
+        if(!strncmp(line,"io_backend",10)){
+            char be[16];
+            if(sscanf(line,"io_backend %15s", be)!=1) die("bad io_backend");
+            if(!strcmp(be,"uring")) R->use_uring=true;
+            else if(strcmp(be,"select")) die("unknown io_backend %s", be);
+            continue;
+        }
+
+        if(!strncmp(line,"link_metric",11)){
+            char kind[16]; int unit=0;
+            int k=sscanf(line,"link_metric %15s %d", kind, &unit);
+            if(k>=1 && !strcmp(kind,"static")) R->rtt_unit_us=0;
+            else if(k==2 && !strcmp(kind,"rtt") && unit>0) R->rtt_unit_us=(uint32_t)unit;
+            else die("bad link_metric (want \"static\" or \"rtt <usec_per_cost>\")");
+            continue;
+        }
+
+        if(!strncmp(line,"dampening",9)){
+            char v[8];
+            if(sscanf(line,"dampening %7s", v)!=1) die("bad dampening");
+            if(!strcmp(v,"on")) R->damp_on=true;
+            else if(!strcmp(v,"off")) R->damp_on=false;
+            else die("bad dampening (want on or off)");
+            continue;
+        }
+
         if(!strncmp(line,"routes",6)){ in_routes=true; in_neigh=false; continue; }
         if(!strncmp(line,"neighbors",9)){ in_neigh=true; in_routes=false; continue; }
 
@@ -181,15 +251,18 @@ static void parse_conf(router_t* R, const char* path){
                 e->cost = (a3.s_addr==0)?0:1;  // cost=0 for connected network
                 snprintf(e->iface,sizeof(e->iface),"%s",ifn);
                 e->last_update = time(NULL);
+                e->local = true;
             }
         } else if(in_neigh){
             char ip[64]; int port, cost;
             if(sscanf(line,"%63s %d %d", ip, &port, &cost)==3){
                 struct in_addr a; if(!inet_aton(ip,&a)) die("bad neighbor ip");
                 if(R->num_neighbors>=MAX_NEIGH) die("too many neighbors");
+                if(nb_find(R,a.s_addr,(uint16_t)port)) die("duplicate neighbor: %s", line);
                 neighbor_t* nb = &R->neighbors[R->num_neighbors++];
                 *nb = (neighbor_t){ .ip=a.s_addr, .ctrl_port=(uint16_t)port,
-                                    .cost=(uint16_t)cost, .last_heard=time(NULL),
+                                    .cost=(uint16_t)cost, .base_cost=(uint16_t)cost,
+                                    .last_heard=time(NULL),
                                     .alive=true };
             }
         }
@@ -203,7 +276,18 @@ static void parse_conf(router_t* R, const char* path){
 /* -------------------------------------------------------------------------
  * Create and bind a UDP socket on the given port.
  * You may reuse this helper for control and data sockets.
+ *
+ * These listening sockets take traffic from anyone (sendpkt, routers not yet
+ * connected). Each neighbor also gets its own sockets from udp_connect(),
+ * sharing the port through SO_REUSEPORT.
  * ------------------------------------------------------------------------- */
+static void udp_reuse(int s){
+    int on = 1;
+    if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+        die("setsockopt: %s", strerror(errno));
+}
+
 static inline int udp_bind(uint16_t p){
     int s = socket(AF_INET, SOCK_DGRAM, 0);
     if (s < 0) die("socket: %s", strerror(errno));
@@ -213,11 +297,291 @@ static inline int udp_bind(uint16_t p){
     a.sin_addr.s_addr = htonl(INADDR_ANY);
     a.sin_port = htons(p);
 
+    // With SO_REUSEPORT a second router on this port would bind silently and
+    // split the traffic; bind once without it first so that fails instead
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+        die("bind %u: %s", p, strerror(errno));
+    close(s);
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) die("socket: %s", strerror(errno));
+    udp_reuse(s);
     if (bind(s, (struct sockaddr*)&a, sizeof(a)) < 0)
         die("bind %u: %s", p, strerror(errno));
     return s;
 }
 
+/* -------------------------------------------------------------------------
+ * Create a UDP socket bound to self_ip:sport and connect()ed to ip:dport.
+ * The kernel resolves the route once at connect() instead of on every
+ * send, and delivers everything that peer sends to sport on this socket,
+ * so the socket itself identifies the neighbor.
+ * ------------------------------------------------------------------------- */
+static int udp_connect(uint32_t self_ip, uint16_t sport, uint32_t ip, uint16_t dport){
+    int s = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) die("socket: %s", strerror(errno));
+    udp_reuse(s);
+
+    struct sockaddr_in a = {0};
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = self_ip;
+    a.sin_port = htons(sport);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+        die("bind %s:%u: %s", inet_ntoa(a.sin_addr), sport, strerror(errno));
+
+    a.sin_addr.s_addr = ip;
+    a.sin_port = htons(dport);
+    if (connect(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+        die("connect %s:%u: %s", inet_ntoa(a.sin_addr), dport, strerror(errno));
+    return s;
+}
+
+static void nb_open(router_t* R){
+    for(int i = 0; i < R->num_neighbors; i++){
+        neighbor_t* nb = &R->neighbors[i];
+        nb->sock_ctrl = udp_connect(R->self_ip, R->ctrl_port, nb->ip, nb->ctrl_port);
+        nb->sock_data = udp_connect(R->self_ip, get_data_port(R->ctrl_port),
+                                    nb->ip, get_data_port(nb->ctrl_port));
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * Route-change event feed
+ *
+ * Subscribers connect to a SOCK_SEQPACKET Unix socket and receive one
+ * route_event_t per message (format in common.h). All sends are
+ * non-blocking: a subscriber whose socket buffer is full is disconnected
+ * rather than stalling dv_update(), and is expected to reconnect and
+ * resync from the snapshot it gets on connect.
+ * ------------------------------------------------------------------------- */
+static void ev_open(router_t* R){
+    R->sock_ev = -1;
+    if(!R->ev_path[0]) return;
+
+    int s = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+    if (s < 0) die("socket(AF_UNIX): %s", strerror(errno));
+
+    struct sockaddr_un a = {0};
+    a.sun_family = AF_UNIX;
+    snprintf(a.sun_path, sizeof(a.sun_path), "%s", R->ev_path);
+    unlink(a.sun_path);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) < 0)
+        die("bind %s: %s", R->ev_path, strerror(errno));
+    if (listen(s, MAX_SUBS) < 0)
+        die("listen %s: %s", R->ev_path, strerror(errno));
+    R->sock_ev = s;
+}
+
+static void ev_close(router_t* R){
+    if(R->sock_ev < 0) return;
+    for(int i = 0; i < R->num_subs; i++) close(R->subs[i]);
+    R->num_subs = 0;
+    close(R->sock_ev);
+    unlink(R->ev_path);
+}
+
+static bool ev_send(int fd, uint8_t type, uint32_t seq, const route_entry_t* e){
+    route_event_t ev = { .type = type, .seq = htonl(seq) };
+    if(e){
+        ev.net = e->dest_net;
+        ev.mask = e->mask;
+        ev.next_hop = e->next_hop;
+        ev.cost = htons(e->cost);
+        ev.nh_port = htons(e->nh_port);
+    }
+    return send(fd, &ev, sizeof(ev), MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t)sizeof(ev);
+}
+
+static void ev_drop_sub(router_t* R, int i, const char* why){
+    fprintf(stderr, "[R%u] event subscriber dropped (%s)\n", R->self_id, why);
+    close(R->subs[i]);
+    R->subs[i] = R->subs[--R->num_subs];
+}
+
+// Accept a new subscriber and send it a snapshot of all present routes
+static void ev_accept(router_t* R){
+    int fd = accept(R->sock_ev, NULL, NULL);
+    if(fd < 0) return;
+    if(R->num_subs >= MAX_SUBS){ close(fd); return; }
+
+    bool ok = ev_send(fd, EV_SNAP_BEGIN, R->ev_seq, NULL);
+    for(int i = 0; ok && i < R->num_routes; i++)
+        if(R->routes[i].cost < INF_COST)
+            ok = ev_send(fd, EV_ADD, R->ev_seq, &R->routes[i]);
+    ok = ok && ev_send(fd, EV_SNAP_END, R->ev_seq, NULL);
+    if(!ok){ close(fd); return; }
+    R->subs[R->num_subs++] = fd;
+}
+
+// Publish the change (if any) of route e from (old_nh, old_port, old_cost) to its current state
+static void ev_route_changed(router_t* R, const route_entry_t* e, uint32_t old_nh,
+                             uint16_t old_port, uint16_t old_cost){
+    uint8_t type;
+    if(old_cost >= INF_COST && e->cost >= INF_COST) return;
+    if(old_cost >= INF_COST) type = EV_ADD;
+    else if(e->cost >= INF_COST) type = EV_WITHDRAW;
+    else if(old_cost != e->cost || old_nh != e->next_hop || old_port != e->nh_port) type = EV_MODIFY;
+    else return;
+
+    uint32_t seq = ++R->ev_seq;
+    for(int i = R->num_subs - 1; i >= 0; i--)
+        if(!ev_send(R->subs[i], type, seq, e))
+            ev_drop_sub(R, i, errno == EAGAIN || errno == EWOULDBLOCK ? "slow" : strerror(errno));
+}
+
+/* -------------------------------------------------------------------------
+ * Packet capture (pcap format in common.h)
+ *
+ * cap_record() only copies the packet into cap_buf; the write() happens in
+ * cap_flush(), which the main loop calls between packets. If the buffer is
+ * full the record is dropped and counted rather than stalling forwarding.
+ * ------------------------------------------------------------------------- */
+static void cap_open(router_t* R){
+    R->cap_fd = -1;
+    if(!R->cap_path[0]) return;
+
+    int fd = open(R->cap_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) die("open %s: %s", R->cap_path, strerror(errno));
+    R->cap_buf = malloc(CAP_BUF_SIZE);
+    if (!R->cap_buf) die("capture buffer: out of memory");
+
+    pcap_hdr_t h = { .magic = PCAP_MAGIC, .ver_major = 2, .ver_minor = 4,
+                     .snaplen = sizeof(data_msg_t), .linktype = PCAP_LINKTYPE };
+    memcpy(R->cap_buf, &h, sizeof(h));
+    R->cap_len = sizeof(h);
+    R->cap_fd = fd;
+}
+
+static void cap_flush(router_t* R){
+    size_t off = 0;
+    while(off < R->cap_len){
+        ssize_t w = write(R->cap_fd, R->cap_buf + off, R->cap_len - off);
+        if(w < 0){
+            if(errno == EINTR) continue;
+            perror("ERROR: write() capture file failed");
+            break;
+        }
+        off += (size_t)w;
+    }
+    R->cap_len = 0;
+}
+
+static void cap_record(router_t* R, const void* pkt, size_t len){
+    if(R->cap_len + sizeof(pcap_rec_t) + len > CAP_BUF_SIZE){
+        R->cap_drops++;
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    pcap_rec_t rec = { .ts_sec = (uint32_t)ts.tv_sec, .ts_usec = (uint32_t)(ts.tv_nsec / 1000),
+                       .incl_len = (uint32_t)len, .orig_len = (uint32_t)len };
+    memcpy(R->cap_buf + R->cap_len, &rec, sizeof(rec));
+    memcpy(R->cap_buf + R->cap_len + sizeof(rec), pkt, len);
+    R->cap_len += sizeof(rec) + len;
+}
+
+static void cap_close(router_t* R){
+    if(R->cap_fd < 0) return;
+    cap_flush(R);
+    close(R->cap_fd);
+    free(R->cap_buf);
+    if(R->cap_drops)
+        fprintf(stderr, "[R%u] capture dropped %u packets\n", R->self_id, R->cap_drops);
+}
+
+/* -------------------------------------------------------------------------
+ * I/O backends
+ *
+ * The default backend is the select() loop in run_select(). With
+ * "io_backend uring" the router instead runs run_uring(): both sockets are
+ * read with multishot recvmsg into a provided-buffer ring, sends are queued
+ * as SQEs and submitted together with the next wait, and a ring timeout
+ * replaces the select() timeout. Packet handling is shared by both.
+ * ------------------------------------------------------------------------- */
+#if HAVE_URING
+#define URING_ENTRIES    256
+#define URING_NBUFS      256    // Provided receive buffers (power of two)
+#define URING_BUF_SIZE   2048   // recvmsg header + sender address + largest message
+#define URING_SEND_SLOTS 64     // Sends that may be in flight at once
+#define URING_MAX_ERRORS 8      // Consecutive receive errors on one socket before falling back to select()
+
+// user_data: UD_* kind in the low byte, index above it (send slot for UD_SEND,
+// neighbor + 1 for receives on a connected socket, 0 for the listening sockets)
+enum { UD_RECV_CTRL = 1, UD_RECV_DATA, UD_POLL_EV, UD_TIMEOUT, UD_SEND };
+#define UD(kind, idx) ((uint64_t)(kind) | ((uint64_t)(idx) << 8))
+
+// A queued send owns a copy of the message until its completion arrives
+typedef struct {
+    struct msghdr msg;
+    struct iovec iov;
+    struct sockaddr_in to;
+    const char* what;
+    uint8_t buf[URING_BUF_SIZE];
+} uring_send_t;
+
+struct uring_io {
+    uring_t ring;
+    uring_bufs_t bufs;
+    struct msghdr recv_msg;          // Multishot recvmsg template (sender address only)
+    struct __kernel_timespec tick;   // Wakeup interval, replaces the select() timeout
+    int num_free;
+    uint16_t free_slots[URING_SEND_SLOTS];
+    uring_send_t slots[URING_SEND_SLOTS];
+    uint8_t recv_errs[MAX_NEIGH + 1][2]; // Consecutive receive errors, [neighbor + 1][ctrl, data]
+    bool failed;                     // Receives keep failing: leave run_uring() for select()
+};
+
+// Next SQE, submitting what is already queued if the ring is full
+static struct io_uring_sqe* io_sqe(struct uring_io* io){
+    struct io_uring_sqe* sqe = uring_get_sqe(&io->ring);
+    if(!sqe){
+        uring_submit(&io->ring, 0);
+        sqe = uring_get_sqe(&io->ring);
+    }
+    return sqe;
+}
+
+static bool uring_queue_send(struct uring_io* io, int fd, const void* buf, size_t len,
+                             const struct sockaddr_in* to, const char* what){
+    if(!io->num_free || len > URING_BUF_SIZE) return false;
+    struct io_uring_sqe* sqe = io_sqe(io);
+    if(!sqe) return false;
+
+    uint16_t i = io->free_slots[--io->num_free];
+    uring_send_t* sl = &io->slots[i];
+    memcpy(sl->buf, buf, len);
+    sl->iov = (struct iovec){ .iov_base = sl->buf, .iov_len = len };
+    sl->msg = (struct msghdr){ .msg_iov = &sl->iov, .msg_iovlen = 1 };
+    if(to){
+        sl->to = *to;
+        sl->msg.msg_name = &sl->to;
+        sl->msg.msg_namelen = sizeof(sl->to);
+    }
+    sl->what = what;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&sl->msg;
+    sqe->len = 1;
+    sqe->user_data = UD(UD_SEND, i);
+    return true;
+}
+#endif
+
+// Send one datagram on fd. With the io_uring backend the send is only queued
+// and goes out with the next batch; "what" labels errors in either case.
+static void io_send(router_t* R, int fd, const void* buf, size_t len,
+                    const struct sockaddr_in* to, const char* what){
+#if HAVE_URING
+    if(R->uring && uring_queue_send(R->uring, fd, buf, len, to, what)) return;
+#else
+    (void)R;
+#endif
+    // ECONNREFUSED only means a connected neighbor is not running (yet)
+    if(sendto(fd, buf, len, 0, (const struct sockaddr*)to, to ? sizeof(*to) : 0) < 0 && errno != ECONNREFUSED)
+        perror(what);
+}
+
 /* -------------------------------------------------------------------------
  * TODO #1: Send Distance Vector update to a single neighbor
  *    - Fill dv_msg_t with routes and costs
@@ -236,7 +600,7 @@ static void send_dv(router_t* R, const neighbor_t* nb){
         route_entry_t* route = &R->routes[i];
         uint16_t cost = route->cost;
         // Split horizon: Do not advertise a route back to the neighbor from which it was learned.
-        if (route->next_hop == nb->ip)
+        if (rt_via(route, nb))
         {
             // Poison reverse: If a route was learned from a neighbor, still advertise it back, but with an infinite cost
             cost = INF_COST;
@@ -250,17 +614,9 @@ static void send_dv(router_t* R, const neighbor_t* nb){
         }
     }
     m.num = htons(m.num);
-    // Use sendto() to transmit the message
-    struct sockaddr_in dest = {0};
-    dest.sin_family = AF_INET;
-    // Exchange messages locally through loopback interface
-    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-    dest.sin_port = htons(nb->ctrl_port);
+    // Send on the control socket connect()ed to this neighbor
     size_t msgSize = sizeof(m.type) + sizeof(m.sender_id) + sizeof(m.num) + (ntohs(m.num) * sizeof(m.e[0]));
-    if(sendto(R->sock_ctrl, &m, msgSize, 0, (struct sockaddr*)&dest, sizeof(dest)) < 0)
-    {
-        perror("ERROR: sendto for DV update errrored.");
-    }
+    io_send(R, nb->sock_ctrl, &m, msgSize, NULL, "ERROR: sendto for DV update errrored.");
 }
 
 /* -------------------------------------------------------------------------
@@ -279,70 +635,207 @@ static void broadcast_dv(router_t* R){
     }
 }
 
+/* -------------------------------------------------------------------------
+ * Latency-aware link costs ("link_metric rtt <usec_per_cost>")
+ *
+ * Every second each neighbor is probed; replies give an RTT sample that is
+ * smoothed with an EWMA. The link cost is base_cost + srtt / rtt_unit_us, but
+ * it only moves once srtt is half a unit outside the band of the current
+ * cost, so an RTT hovering on a boundary does not flap the route.
+ * ------------------------------------------------------------------------- */
+static uint64_t mono_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void send_probe(router_t* R, const neighbor_t* nb){
+    probe_msg_t p = { .type = MSG_PROBE, .sender_id = htons(R->self_id), .sent_ns = mono_ns() };
+    io_send(R, nb->sock_ctrl, &p, sizeof(p), NULL, "ERROR: sendto for link probe failed");
+}
+
+// Log a link cost change; routes are recomputed with the rest of the batch,
+// and the table is logged only if that changes one
+static void apply_link_cost(router_t* R, neighbor_t* nb, uint16_t old_cost){
+    char ipbuf[32];
+    printf("[R%u] LINK %s rtt=%uus cost %u->%u\n", R->self_id,
+           ipstr(nb->ip, ipbuf, sizeof(ipbuf)), nb->srtt_us, old_cost, nb->cost);
+    fflush(stdout);
+    R->pending_log = "link-cost";
+}
+
+static void on_probe_reply(router_t* R, neighbor_t* nb, const probe_msg_t* p){
+    uint64_t now = mono_ns();
+    if(p->sent_ns > now) return;
+    uint64_t rtt = (now - p->sent_ns) / 1000;
+    if(rtt > UINT32_MAX) rtt = UINT32_MAX;
+
+    // EWMA: srtt += (rtt - srtt) / 2^RTT_EWMA_SHIFT
+    if(nb->srtt_us == 0) nb->srtt_us = (uint32_t)rtt ? (uint32_t)rtt : 1;
+    else nb->srtt_us = (uint32_t)((int64_t)nb->srtt_us + (((int64_t)rtt - nb->srtt_us) >> RTT_EWMA_SHIFT));
+    if(!R->rtt_unit_us) return;
+
+    // Hysteresis: stay on the current cost while srtt is within its band +/- half a unit
+    uint64_t unit = R->rtt_unit_us;
+    uint64_t lo = (uint64_t)(nb->cost - nb->base_cost) * unit;
+    uint64_t hi = lo + unit;
+    if(nb->srtt_us + unit / 2 >= lo && nb->srtt_us < hi + unit / 2) return;
+
+    uint64_t c = nb->base_cost + nb->srtt_us / unit;
+    uint16_t old_cost = nb->cost;
+    nb->cost = (uint16_t)(c < INF_COST ? c : INF_COST - 1);
+    if(nb->cost != old_cost) apply_link_cost(R, nb, old_cost);
+}
+
 /* -------------------------------------------------------------------------
  * TODO #3: Apply Bellman-Ford update rule
  *    - For each entry in received DV:
  *        new_cost = neighbor_cost + advertised_cost
  *    - If this is a cheaper path, update route table
+ *
+ * dv_update() only records what nb advertised (route_entry_t.adv). The
+ * Bellman-Ford step runs in rt_recompute() over every live neighbor at once,
+ * after the whole batch of queued DVs has been read (dv_commit()).
  * ------------------------------------------------------------------------- */
 static bool dv_update(router_t* R, neighbor_t* nb, const dv_msg_t* m){
-    bool changed = false;
-    // TODO: Implement Bellman-Ford update logic
-    //printf("START dv_update\n");
+    bool changed = !nb->alive;
+    int k = (int)(nb - R->neighbors);
     nb->alive = true;
     nb->last_heard = time(NULL);
     uint16_t numEntries = ntohs(m->num);
-    uint16_t link_cost_to_neighbor = nb->cost;
-    // iterate through table and perform necessary updates
     for(int i = 0; i < numEntries; i++)
     {
-        bool newCostCheaper = false;
-        bool curretnNextHop = false;
-        bool poison = false;
-        uint16_t neighbor_cost_to_destination = ntohs(m->e[i].cost);
         route_entry_t* tableRoute = rt_find_or_add(R, m->e[i].net, m->e[i].mask);
         if(tableRoute == NULL)
         {
             continue;
         }
-        // Check if route is learned from neighbor
-        if(tableRoute->next_hop == nb->ip)
+        uint16_t neighbor_cost_to_destination = ntohs(m->e[i].cost);
+        bool entryChanged = tableRoute->adv[k] != neighbor_cost_to_destination;
+        TRACE_DV_ENTRY(m->e[i].net, m->e[i].mask, nb->ip, neighbor_cost_to_destination, entryChanged);
+        if(entryChanged)
         {
-            curretnNextHop = true;
-            //if it is and neighbor is poisoned, poison this as well
-            if (neighbor_cost_to_destination >= INF_COST)
-            {
-                poison = true;
-            }
+            tableRoute->adv[k] = neighbor_cost_to_destination;
+            changed = true;
         }
-        // Bellman Ford: new_cost = link_cost_to_neighbor + neighbor_cost_to_destination
-        uint16_t new_cost = link_cost_to_neighbor + neighbor_cost_to_destination;
-        // Check for overflow
-        if(neighbor_cost_to_destination >= INF_COST)
-        {
-            new_cost = INF_COST;
+    }
+    return changed;
+}
+
+/* -------------------------------------------------------------------------
+ * Route flap dampening ("dampening on")
+ *
+ * Each learned route carries a penalty that grows when its best path is
+ * lost or moves to another next hop, and halves every 60 seconds. Past
+ * DAMP_SUPPRESS the route is treated as unreachable (not installed, and
+ * advertised as INF_COST) until the penalty decays below DAMP_REUSE, so a
+ * flapping link stops triggering recomputations and broadcasts downstream.
+ * ------------------------------------------------------------------------- */
+static void damp_log(router_t* R, const route_entry_t* e, const char* what){
+    char n1[32], n2[32];
+    printf("[R%u] DAMP %s %s/%s penalty=%u suppressed=%d suppressions=%u flaps=%u\n", R->self_id, what,
+           ipstr(e->dest_net, n1, sizeof(n1)), ipstr(e->mask, n2, sizeof(n2)),
+           e->penalty, R->damp_suppressed, R->damp_suppress_total, R->damp_flaps);
+    fflush(stdout);
+}
+
+// Charge a flap if the pre-dampening best path of e went away or moved to nb
+static void damp_update(router_t* R, route_entry_t* e, const neighbor_t* nb){
+    bool up = nb != NULL;
+    uint32_t add = 0;
+    if(e->reachable && !up) add = DAMP_PENALTY_WITHDRAW;
+    else if(e->reachable && !rt_via(e, nb)) add = DAMP_PENALTY_CHANGE;
+    e->reachable = up;
+    if(!add) return;
+
+    add += e->penalty;
+    e->penalty = (uint16_t)(add < DAMP_MAX ? add : DAMP_MAX);
+    R->damp_flaps++;
+    if(!e->suppressed && e->penalty >= DAMP_SUPPRESS){
+        e->suppressed = true;
+        R->damp_suppressed++;
+        R->damp_suppress_total++;
+        damp_log(R, e, "suppress");
+    }
+}
+
+// Decay all penalties once per elapsed second; release routes below DAMP_REUSE
+static void damp_decay(router_t* R, time_t now){
+    if(!R->damp_on || now <= R->last_decay) return;
+    time_t secs = R->last_decay ? now - R->last_decay : 1;
+    R->last_decay = now;
+    if(secs > 300) secs = 300; // DAMP_MAX decays below DAMP_REUSE well within this
+
+    for(int i = 0; i < R->num_routes; i++){
+        route_entry_t* e = &R->routes[i];
+        if(!e->penalty) continue;
+        uint32_t p = e->penalty;
+        for(time_t t = 0; t < secs && p; t++) p = (p * DAMP_DECAY_Q16) >> 16;
+        e->penalty = (uint16_t)p;
+        if(e->suppressed && e->penalty < DAMP_REUSE){
+            e->suppressed = false;
+            R->damp_suppressed--;
+            damp_log(R, e, "reuse");
+            R->pending_log = "damp-reuse";
         }
-        // If this new_cost is smaller than your current cost, you update your table to use that neighbor as the new next hop.
-        if(new_cost < tableRoute->cost)
-        {
-            newCostCheaper = true;
+    }
+}
+
+// Pick the cheapest live neighbor for every learned route. Ties keep the
+// current next hop; suppressed routes stay at INF_COST. Publishes route
+// events; returns true if any route changed.
+static bool rt_recompute(router_t* R){
+    int changed = 0;
+    TRACE_RECOMPUTE_START(R->num_routes);
+    for(int i = 0; i < R->num_routes; i++){
+        route_entry_t* e = &R->routes[i];
+        if(e->local) continue;
+
+        uint32_t best = INF_COST;
+        const neighbor_t* best_nb = NULL;
+        for(int k = 0; k < R->num_neighbors; k++){
+            const neighbor_t* nb = &R->neighbors[k];
+            if(!nb->alive || e->adv[k] >= INF_COST) continue;
+            uint32_t c = (uint32_t)nb->cost + e->adv[k];
+            if(c < best || (c == best && best_nb && rt_via(e, nb))){
+                best = c;
+                best_nb = nb;
+            }
         }
-        if (newCostCheaper || poison)
-        {
-            changed = true;
+
+        uint32_t old_nh = e->next_hop;
+        uint16_t old_port = e->nh_port, old_cost = e->cost;
+        if(R->damp_on){
+            damp_update(R, e, best_nb);
+            if(e->suppressed) best = INF_COST;
         }
-        if(newCostCheaper || curretnNextHop)
-        {
-            tableRoute->cost = new_cost;
-            if(new_cost < INF_COST)
-            {
-                tableRoute->next_hop = nb->ip;
-            }
-            tableRoute->last_update = time(NULL);
+        if(best_nb){
+            e->next_hop = best_nb->ip;
+            e->nh_port = best_nb->ctrl_port;
+        }
+        // Unreachable routes keep their last next hop, poisoned
+        e->cost = (uint16_t)best;
+        if(e->cost != old_cost || e->next_hop != old_nh || e->nh_port != old_port){
+            e->last_update = time(NULL);
+            TRACE_ROUTE_CHANGE(e->dest_net, e->mask, e->next_hop, old_cost, e->cost);
+            ev_route_changed(R, e, old_nh, old_port, old_cost);
+            changed++;
         }
     }
-    //printf("END dv_update\n");
-    return changed;
+    TRACE_RECOMPUTE_DONE(changed);
+    return changed > 0;
+}
+
+// End of a batch: one recomputation, one table log and at most one
+// triggered advertisement, however many DVs the batch contained
+static void dv_commit(router_t* R){
+    if(!R->pending_log) return;
+    const char* why = R->pending_log;
+    R->pending_log = NULL;
+    if(rt_recompute(R)){
+        log_table(R, why);
+        broadcast_dv(R);
+    }
 }
 
 /* -------------------------------------------------------------------------
@@ -353,22 +846,20 @@ static bool dv_update(router_t* R, neighbor_t* nb, const dv_msg_t* m){
  * ------------------------------------------------------------------------- */
 static void forward_data(router_t* R, const data_msg_t* in){
     // TODO: Implement packet forwarding using LPM
-    //printf("START forward_data\n");
     // Decrement TTL
-    //printf("MARKER 0\n");
     data_msg_t outMsg = *in;
     outMsg.ttl--;
     char out_dst_ip[32];
-    //printf("MARKER 1\n");
     ipstr(outMsg.src_ip, out_dst_ip, sizeof(out_dst_ip));
-    //printf("MARKER 2\n");
     // Perform LPM lookup to find next hop
     route_entry_t* route = rt_lookup(R, outMsg.dst_ip);
-    //printf("MARKER 3\n");
-    // Deliver locally if directly connected
-    //printf("Self_ip: %d\n, dst_ip: %d\n", R->self_ip, outMsg.dst_ip);
-    if(route && route->next_hop == 0)
+    TRACE_LPM_RESULT(outMsg.dst_ip, route ? route->dest_net : 0, route ? route->mask : 0,
+                     route ? route->next_hop : 0);
+    // Deliver locally if directly connected (a configured route; a learned
+    // route that never had a live offer also has next_hop 0)
+    if(route && route->local)
     {
+        TRACE_PKT_DELIVER(outMsg.dst_ip, outMsg.ttl);
         printf("[R%u] DELIVER src=%s ttl=%u payload=\"%.*s\"\n",R->self_id,out_dst_ip, outMsg.ttl, ntohs(outMsg.payload_len), outMsg.payload);
         fflush(stdout);
         return;
@@ -377,6 +868,7 @@ static void forward_data(router_t* R, const data_msg_t* in){
     // If not locally connected check first if ttl is 0
     if(outMsg.ttl == 0)
     {
+        TRACE_PKT_DROP(outMsg.dst_ip, TRACE_DROP_TTL);
         printf("[R%u] DROP ttl=0\n",R->self_id);
         fflush(stdout);
         return;
@@ -386,6 +878,7 @@ static void forward_data(router_t* R, const data_msg_t* in){
     // Check is route exists
     if(route == NULL)
     {
+        TRACE_PKT_DROP(outMsg.dst_ip, TRACE_DROP_NO_MATCH);
         printf("[R%u] NO MATCH dst=%s\n",R->self_id, out_dst_ip);
         fflush(stdout);
         return;
@@ -394,38 +887,35 @@ static void forward_data(router_t* R, const data_msg_t* in){
     // Get next hop info
     uint32_t nextHopIP = route->next_hop;
     ipstr(nextHopIP, out_dst_ip, sizeof(out_dst_ip));
-    //printf("next hop IP: %s", out_dst_ip);
     uint16_t nextHopCost = route->cost;
-    neighbor_t* nextHopNb = NULL;
-    for (int i = 0; i< R->num_neighbors; i++)
+    neighbor_t* nextHopNb = nb_find(R, nextHopIP, route->nh_port);
+    if (nextHopNb != NULL && !nextHopNb->alive)
     {
-        if(R->neighbors[i].ip == nextHopIP)
-        {
-            nextHopNb = &R->neighbors[i];
-            break;
-        }
+        TRACE_PKT_DROP(outMsg.dst_ip, TRACE_DROP_NEXT_HOP_DOWN);
+        printf("[R%u] NEXT HOP DOWN %s\n",R->self_id, out_dst_ip);
+        fflush(stdout);
+        return;
     }
-    //
-    if (nextHopNb == NULL)
+    // A poisoned route keeps its last next hop, which may itself hold a stale
+    // route back to us; forwarding on it would loop until the TTL runs out.
+    // Suppressed (dampened) routes are held at INF_COST and end here too, as
+    // do learned routes with no next hop yet.
+    if (nextHopNb == NULL || route->cost >= INF_COST)
     {
-
+        char dstStr[32];
+        TRACE_PKT_DROP(outMsg.dst_ip, TRACE_DROP_NO_MATCH);
+        printf("[R%u] NO MATCH dst=%s\n",R->self_id, ipstr(outMsg.dst_ip, dstStr, sizeof(dstStr)));
+        fflush(stdout);
+        return;
     }
-    uint16_t nextHopPort = get_data_port(nextHopNb->ctrl_port);
+    TRACE_PKT_FORWARD(outMsg.dst_ip, nextHopIP, nextHopCost, outMsg.ttl);
     char viaStr[32];
     ipstr(nextHopIP, viaStr, sizeof(viaStr));
     printf("[R%u] FWD dst=%s via=%s cost=%u ttl=%u\n",R->self_id,out_dst_ip, viaStr,nextHopCost,outMsg.ttl);
     fflush(stdout);
-    // Send to next hop's port
-    struct sockaddr_in dest = {0};
-    dest.sin_family = AF_INET;
-    dest.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-    dest.sin_port = htons(nextHopPort);
+    // Send on the data socket connect()ed to the next hop's data port
     size_t msgSize = sizeof(outMsg.type) + sizeof(outMsg.ttl) + sizeof(outMsg.src_ip) + sizeof(outMsg.dst_ip) + sizeof(outMsg.payload_len) + ntohs(in->payload_len);;
-    if(sendto(R->sock_data, &outMsg, msgSize, 0, (struct sockaddr*)&dest, sizeof(dest)) < 0)
-    {
-        perror("ERROR: sendto() data packet failed");
-    }
-    //printf("END forward_data\n");
+    io_send(R, nextHopNb->sock_data, &outMsg, msgSize, NULL, "ERROR: sendto() data packet failed");
 }
 
 /* -------------------------------------------------------------------------
@@ -435,125 +925,401 @@ static volatile sig_atomic_t running=1;
 static void on_sigint(int _){ (void)_; running=0; }
 
 /* -------------------------------------------------------------------------
- * Main event loop
+ * Packet and timer handling shared by both I/O backends
  * ------------------------------------------------------------------------- */
-int main(int argc, char** argv){
-    if(argc != 2) die("Usage: %s <conf>", argv[0]);
-    router_t R = {0};
-    parse_conf(&R, argv[1]);
+// sender_nb is the neighbor whose connected socket received the message, or
+// NULL if it arrived on the listening socket
+static void handle_ctrl(router_t* R, neighbor_t* sender_nb, const dv_msg_t* m, size_t len,
+                        const struct sockaddr_in* from){
+    if(len == 0)
+    {
+        return;
+    }
+    // Neighbors are keyed on (ip, control port)
+    if(sender_nb == NULL)
+    {
+        sender_nb = nb_find(R, from->sin_addr.s_addr, ntohs(from->sin_port));
+    }
 
-    signal(SIGINT, on_sigint);
-    R.sock_ctrl = udp_bind(R.ctrl_port);
-    R.sock_data = udp_bind(get_data_port(R.ctrl_port));
+    // Link probes: answer every probe, measure RTT from replies
+    if(m->type == MSG_PROBE && len == sizeof(probe_msg_t))
+    {
+        probe_msg_t reply;
+        memcpy(&reply, m, sizeof(reply));
+        reply.type = MSG_PROBE_REPLY;
+        if(sender_nb) io_send(R, sender_nb->sock_ctrl, &reply, sizeof(reply), NULL, "ERROR: sendto for probe reply failed");
+        return;
+    }
+    if(m->type == MSG_PROBE_REPLY && len == sizeof(probe_msg_t))
+    {
+        if(sender_nb) on_probe_reply(R, sender_nb, (const probe_msg_t*)m);
+        return;
+    }
 
-    time_t next_broadcast = time(NULL) + UPDATE_INTERVAL_SEC;
-    log_table(&R, "init");
-    //----------------------------------------------------------------------
-    // Main event loop using select()
-    //
-    // - Wait for control (DV) or data packets
-    // - Wake up periodically (every 1 second) to broadcast updates using select timeout
-    // - Detect dead neighbors (no DV received for DEAD_INTERVAL_SEC)
-    //----------------------------------------------------------------------
+    // Check this is a DV message
+    if(len < offsetof(dv_msg_t, e) || m->type != MSG_DV)
+    {
+        return;
+    }
+    if(ntohs(m->num) > (len - offsetof(dv_msg_t, e)) / sizeof(m->e[0]))
+    {
+        return;
+    }
+    if(sender_nb == NULL)
+    {
+        return;
+    }
+    // Record the DV; the routing table is recomputed once per batch in dv_commit()
+    TRACE_DV_RECV(sender_nb->ip, sender_nb->ctrl_port, ntohs(m->num), len);
+    bool changed = dv_update(R,sender_nb,m);
+    TRACE_DV_APPLIED(sender_nb->ip, changed);
+    if(changed && !R->pending_log)
+    {
+        R->pending_log = "dv_update";
+    }
+}
+
+static void handle_data(router_t* R, const data_msg_t* msg, size_t len){
+    if (len < offsetof(data_msg_t, payload) || msg->type != MSG_DATA)
+    {
+        return;
+    }
+    if (ntohs(msg->payload_len) > len - offsetof(data_msg_t, payload))
+    {
+        return;
+    }
+    TRACE_PKT_RECV(msg->dst_ip, msg->src_ip, msg->ttl, len);
+    if (R->cap_fd >= 0)
+    {
+        cap_record(R, msg, len);
+    }
+
+    // call forward data if msg data
+    forward_data(R, msg);
+}
+
+// Periodic work: DV broadcast, neighbor timeouts, capture flush.
+// Called after every wakeup, so at least once per second.
+static void router_tick(router_t* R){
+    time_t now = time(NULL);
+
+    // Periodic broadcast
+    if(now >= R->next_broadcast){
+        broadcast_dv(R);
+        R->next_broadcast = now + UPDATE_INTERVAL_SEC;
+    }
+
+    // Link probes for latency-aware costs
+    if(R->rtt_unit_us && now != R->last_probe){
+        for(int i=0; i<R->num_neighbors; i++) send_probe(R, &R->neighbors[i]);
+        R->last_probe = now;
+    }
+
+    //Neighbor timeout detection
+    // Routes through a dead neighbor move to the next best live neighbor,
+    // or are poisoned (cost=INF_COST) if there is none
+    bool deadNeighbor = false;
+    for(int i=0; i<R->num_neighbors; i++){
+        neighbor_t* nb = &R->neighbors[i];
+        if(nb->alive && (now-(nb->last_heard)) >= DEAD_INTERVAL_SEC)
+        {
+            nb->alive = false;
+            deadNeighbor = true;
+            // Forget its advertisements: when it comes back, only routes in
+            // its fresh DVs may go through it again
+            for(int j=0; j<R->num_routes; j++) R->routes[j].adv[i] = INF_COST;
+            TRACE_NEIGHBOR_DEAD(nb->ip, nb->ctrl_port);
+        }
+    }
+    if (deadNeighbor)
+    {
+        R->pending_log = NULL;
+        bool changed = rt_recompute(R);
+        log_table(R,"neighbor-dead");
+        // Nothing to tell downstream if no route moved (e.g. all suppressed)
+        if(changed) broadcast_dv(R);
+    }
+
+    // Decay flap penalties; routes that stabilized rejoin the table
+    damp_decay(R, now);
+    dv_commit(R);
+
+    // Write out captured packets once per second or when half the buffer is used
+    if(R->cap_fd >= 0 && R->cap_len > 0 && (now != R->last_cap_flush || R->cap_len >= CAP_BUF_SIZE / 2)){
+        cap_flush(R);
+        R->last_cap_flush = now;
+    }
+}
+
+//----------------------------------------------------------------------
+// Main event loop using select()
+//
+// - Wait for control (DV) or data packets
+// - Wake up periodically (every 1 second) to broadcast updates using select timeout
+// - Detect dead neighbors (no DV received for DEAD_INTERVAL_SEC)
+//----------------------------------------------------------------------
+// Read every control message already queued on fd
+static void recv_ctrl(router_t* R, int fd, neighbor_t* nb){
+    for(int i = 0; i < CTRL_BATCH_MAX; i++){
+        dv_msg_t m;
+        struct sockaddr_in sender_addr;
+        socklen_t addr_len = sizeof(sender_addr);
+        ssize_t len = recvfrom(fd, &m, sizeof(m), MSG_DONTWAIT,(struct sockaddr*)&sender_addr, &addr_len);
+        if(len < 0 && errno == ECONNREFUSED) continue;
+        if(len <= 0) break;
+        handle_ctrl(R, nb, &m, (size_t)len, &sender_addr);
+    }
+}
+
+static void recv_data(router_t* R, int fd){
+    data_msg_t msg;
+    struct sockaddr_in senderAddr;
+    socklen_t addrLen = sizeof(senderAddr);
+    ssize_t len = recvfrom(fd, &msg, sizeof(msg), 0, (struct sockaddr*)&senderAddr, &addrLen);
+    if(len > 0) handle_data(R, &msg, (size_t)len);
+}
+
+static void run_select(router_t* R){
     while(running){
         fd_set rfds; FD_ZERO(&rfds);
-        FD_SET(R.sock_ctrl, &rfds);
-        FD_SET(R.sock_data, &rfds);
-        int maxfd = (R.sock_ctrl > R.sock_data) ? R.sock_ctrl : R.sock_data;
+        FD_SET(R->sock_ctrl, &rfds);
+        FD_SET(R->sock_data, &rfds);
+        int maxfd = (R->sock_ctrl > R->sock_data) ? R->sock_ctrl : R->sock_data;
+        for(int i = 0; i < R->num_neighbors; i++){
+            neighbor_t* nb = &R->neighbors[i];
+            FD_SET(nb->sock_ctrl, &rfds);
+            FD_SET(nb->sock_data, &rfds);
+            if(nb->sock_ctrl > maxfd) maxfd = nb->sock_ctrl;
+            if(nb->sock_data > maxfd) maxfd = nb->sock_data;
+        }
+        if(R->sock_ev >= 0){
+            FD_SET(R->sock_ev, &rfds);
+            if(R->sock_ev > maxfd) maxfd = R->sock_ev;
+        }
         struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
 
         int n = select(maxfd + 1, &rfds, NULL, NULL, &tv);
         if(n < 0 && errno == EINTR) continue;
 
-        time_t now = time(NULL);
+        router_tick(R);
+        if(n <= 0) continue;
 
-        // Periodic broadcast
-        if(now >= next_broadcast){
-            broadcast_dv(&R);
-            next_broadcast = now + UPDATE_INTERVAL_SEC;
-        }
+        //Handle control (DV) messages
+        if(FD_ISSET(R->sock_ctrl, &rfds)) recv_ctrl(R, R->sock_ctrl, NULL);
+        for(int i = 0; i < R->num_neighbors; i++)
+            if(FD_ISSET(R->neighbors[i].sock_ctrl, &rfds))
+                recv_ctrl(R, R->neighbors[i].sock_ctrl, &R->neighbors[i]);
+        dv_commit(R);
 
-        //Neighbor timeout detection
-        for(int i=0; i<R.num_neighbors; i++){
-            // TODO: Neighbor timeout detection (use neighbor_t's last_heard)
-            // If timeout is detected, poison all routes learned from this neighbor
-            // Output a log message with log_table(&R, "neighbor-dead");
-            bool deadNeighbor = false;
-            neighbor_t* nb = &R.neighbors[i];
-            // Check for timeout
-            if(nb->alive && (now-(nb->last_heard)) >= DEAD_INTERVAL_SEC)
-            {
-                nb->alive = false;
-                deadNeighbor = true;
-                // Poison all routes from neighbor
-                for(int j = 0; j < R.num_routes; j++)
-                {
-                    route_entry_t* route = &R.routes[j];
-                    if(route->next_hop == nb->ip)
-                    {
-                        route->cost = INF_COST;
-                        route->last_update = time(NULL);
-                    }
-                }
-            }
-            if (deadNeighbor)
-            {
-                log_table(&R,"neighbor-dead");
-                broadcast_dv(&R);
-            }
+        // New route-event subscribers
+        if(R->sock_ev >= 0 && FD_ISSET(R->sock_ev, &rfds)){
+            ev_accept(R);
         }
 
-        //Handle control (DV) messages
-        if(n > 0 && FD_ISSET(R.sock_ctrl, &rfds)){
-            // TODO: Handle control (DV) messages and call dv_update
-            // If the routing table is changed, output a log message with log_table(&R,"dv-update")
-            dv_msg_t m;
-            struct sockaddr_in sender_addr;
-            socklen_t addr_len = sizeof(sender_addr);
-            ssize_t len = recvfrom(R.sock_ctrl, &m, sizeof(m), 0,(struct sockaddr*)&sender_addr, &addr_len);
-            // Check this is a DV message
-            if(m.type != MSG_DV)
-            {
-                continue;
-            }
-            uint16_t sender_port = ntohs(sender_addr.sin_port);
-            neighbor_t* sender_nb = NULL;
-            // Loop through neighbors till sender is found
-            for(int i = 0; i < R.num_neighbors;i++)
-            {
-                if(R.neighbors[i].ctrl_port == sender_port)
-                {
-                    sender_nb = &R.neighbors[i];
-                }
-            }
-            // Call dv_update with Bellman-Ford
-            bool changed = dv_update(&R,sender_nb,&m);
-            if(changed)
-            {
-                log_table(&R, "dv_update");
-            }
+        // Data packets
+        if(FD_ISSET(R->sock_data, &rfds)) recv_data(R, R->sock_data);
+        for(int i = 0; i < R->num_neighbors; i++)
+            if(FD_ISSET(R->neighbors[i].sock_data, &rfds))
+                recv_data(R, R->neighbors[i].sock_data);
+    }
+}
+
+#if HAVE_URING
+static void uring_arm_recv(struct uring_io* io, int fd, uint64_t ud){
+    struct io_uring_sqe* sqe = io_sqe(io);
+    if(!sqe) die("io_uring: submission queue full");
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&io->recv_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = io->bufs.bgid;
+    sqe->user_data = ud;
+}
+
+static void uring_arm_poll(struct uring_io* io, int fd, uint64_t ud){
+    struct io_uring_sqe* sqe = io_sqe(io);
+    if(!sqe) die("io_uring: submission queue full");
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = ud;
+}
+
+static void uring_arm_timeout(struct uring_io* io){
+    struct io_uring_sqe* sqe = io_sqe(io);
+    if(!sqe) die("io_uring: submission queue full");
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&io->tick;
+    sqe->len = 1;
+    sqe->user_data = UD_TIMEOUT;
+}
+
+static bool uring_open(router_t* R){
+    struct uring_io* io = calloc(1, sizeof(*io));
+    if(!io) return false;
+    int err = uring_init(&io->ring, URING_ENTRIES);
+    if(err == 0){
+        err = uring_bufs_init(&io->ring, &io->bufs, 0, URING_NBUFS, URING_BUF_SIZE);
+        if(err) uring_exit(&io->ring);
+    }
+    if(err){
+        fprintf(stderr, "[R%u] io_uring unavailable (%s), using select()\n", R->self_id, strerror(-err));
+        free(io);
+        return false;
+    }
+    io->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+    io->tick.tv_sec = 1;
+    for(int i = URING_SEND_SLOTS - 1; i >= 0; i--) io->free_slots[io->num_free++] = (uint16_t)i;
+    R->uring = io;
+    return true;
+}
+
+static void uring_close(router_t* R){
+    if(!R->uring) return;
+    uring_exit(&R->uring->ring);
+    uring_bufs_free(&R->uring->bufs);
+    free(R->uring);
+    R->uring = NULL;
+}
+
+static int uring_recv_fd(router_t* R, uint64_t ud){
+    unsigned idx = (unsigned)(ud >> 8);
+    bool ctrl = (ud & 0xff) == UD_RECV_CTRL;
+    if(!idx) return ctrl ? R->sock_ctrl : R->sock_data;
+    return ctrl ? R->neighbors[idx - 1].sock_ctrl : R->neighbors[idx - 1].sock_data;
+}
+
+// One multishot recvmsg completion: hand the payload to the packet handler
+// and give the buffer back to the ring
+static void uring_on_recv(router_t* R, int res, unsigned flags, uint64_t ud){
+    struct uring_io* io = R->uring;
+    unsigned idx = (unsigned)(ud >> 8);
+    neighbor_t* nb = idx ? &R->neighbors[idx - 1] : NULL;
+    bool ctrl = (ud & 0xff) == UD_RECV_CTRL;
+    if(flags & IORING_CQE_F_BUFFER){
+        uint16_t bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t* buf = uring_buf_addr(&io->bufs, bid);
+        const struct io_uring_recvmsg_out* out = (const void*)buf;
+        size_t hdr = sizeof(*out) + io->recv_msg.msg_namelen;
+        if(res >= (int)hdr && !(out->flags & MSG_TRUNC) && out->payloadlen <= (unsigned)res - hdr){
+            struct sockaddr_in from = {0};
+            memcpy(&from, buf + sizeof(*out), sizeof(from));
+            if(ctrl) handle_ctrl(R, nb, (const dv_msg_t*)(buf + hdr), out->payloadlen, &from);
+            else handle_data(R, (const data_msg_t*)(buf + hdr), out->payloadlen);
         }
-        
-        // TODO: Handle data packets
-        if(n > 0 && FD_ISSET(R.sock_data, &rfds)){
-            // TODO: Handle data packets and call forward_data
-            data_msg_t msg;
-            struct sockaddr_in senderAddr;
-            socklen_t addrLen = sizeof(senderAddr);
-            ssize_t len = recvfrom(R.sock_data, &msg, sizeof(msg), 0, (struct sockaddr*)&senderAddr, &addrLen);
-
-            if (msg.type != MSG_DATA)
-            {
-                continue;
-            }
+        uring_buf_recycle(&io->bufs, bid);
+        io->recv_errs[idx][!ctrl] = 0;
+    } else if(res < 0 && res != -ENOBUFS && res != -ECONNREFUSED){
+        fprintf(stderr, "[R%u] io_uring recv: %s\n", R->self_id, strerror(-res));
+        // A persistent error (e.g. multishot recvmsg unsupported) would fail
+        // again on every re-arm and spin the loop
+        if(++io->recv_errs[idx][!ctrl] >= URING_MAX_ERRORS){
+            fprintf(stderr, "[R%u] io_uring receives keep failing, using select()\n", R->self_id);
+            io->failed = true;
+            return;
+        }
+    }
+    // Multishot receives stop on error or when the buffer ring ran dry
+    if(!(flags & IORING_CQE_F_MORE))
+        uring_arm_recv(io, uring_recv_fd(R, ud), ud);
+}
 
-            // call forward data if msg data
-            forward_data(&R, &msg);
+//----------------------------------------------------------------------
+// Main event loop using io_uring
+//
+// Same duties as run_select(): every wakeup (packet or 1 second timeout)
+// drains all completions as one control batch, then runs router_tick(). Sends queued while
+// handling a batch are submitted with the next wait in one syscall.
+// Returns false if receives kept failing and the caller should fall back
+// to run_select().
+//----------------------------------------------------------------------
+static bool run_uring(router_t* R){
+    struct uring_io* io = R->uring;
+    uring_arm_recv(io, R->sock_ctrl, UD(UD_RECV_CTRL, 0));
+    uring_arm_recv(io, R->sock_data, UD(UD_RECV_DATA, 0));
+    for(int i = 0; i < R->num_neighbors; i++){
+        uring_arm_recv(io, R->neighbors[i].sock_ctrl, UD(UD_RECV_CTRL, i + 1));
+        uring_arm_recv(io, R->neighbors[i].sock_data, UD(UD_RECV_DATA, i + 1));
+    }
+    if(R->sock_ev >= 0) uring_arm_poll(io, R->sock_ev, UD_POLL_EV);
+    uring_arm_timeout(io);
+
+    while(running && !io->failed){
+        int r = uring_submit(&io->ring, 1);
+        if(r < 0 && r != -EINTR && r != -EAGAIN && r != -EBUSY)
+            die("io_uring_enter: %s", strerror(-r));
+
+        struct io_uring_cqe* cqe;
+        while(!io->failed && (cqe = uring_peek_cqe(&io->ring))){
+            uint64_t ud = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(&io->ring);
+
+            unsigned kind = (unsigned)(ud & 0xff);
+            if(kind == UD_SEND){
+                uring_send_t* sl = &io->slots[ud >> 8];
+                if(res < 0 && res != -ECONNREFUSED) fprintf(stderr, "%s: %s\n", sl->what, strerror(-res));
+                io->free_slots[io->num_free++] = (uint16_t)(ud >> 8);
+            } else if(kind == UD_RECV_CTRL || kind == UD_RECV_DATA){
+                uring_on_recv(R, res, flags, ud);
+            } else if(kind == UD_POLL_EV){
+                ev_accept(R);
+                if(!(flags & IORING_CQE_F_MORE)) uring_arm_poll(io, R->sock_ev, UD_POLL_EV);
+            } else if(kind == UD_TIMEOUT){
+                uring_arm_timeout(io);
+            }
         }
+        dv_commit(R);
+        router_tick(R);
     }
+    return !io->failed;
+}
+#endif
+
+/* -------------------------------------------------------------------------
+ * Main
+ * ------------------------------------------------------------------------- */
+int main(int argc, char** argv){
+    if(argc != 2) die("Usage: %s <conf>", argv[0]);
+    router_t R = {0};
+    parse_conf(&R, argv[1]);
+
+    signal(SIGINT, on_sigint);
+    R.sock_ctrl = udp_bind(R.ctrl_port);
+    R.sock_data = udp_bind(get_data_port(R.ctrl_port));
+    nb_open(&R);
+    ev_open(&R);
+    cap_open(&R);
+
+    R.next_broadcast = time(NULL) + UPDATE_INTERVAL_SEC;
+    R.last_cap_flush = time(NULL);
+    log_table(&R, "init");
+
+#if HAVE_URING
+    if(R.use_uring && uring_open(&R)){
+        bool ok = run_uring(&R);
+        uring_close(&R);
+        if(!ok) run_select(&R);
+    } else
+#else
+    if(R.use_uring)
+        fprintf(stderr, "[R%u] built without io_uring support, using select()\n", R.self_id);
+#endif
+    run_select(&R);
 
     close(R.sock_ctrl);
     close(R.sock_data);
+    for(int i = 0; i < R.num_neighbors; i++){
+        close(R.neighbors[i].sock_ctrl);
+        close(R.neighbors[i].sock_data);
+    }
+    ev_close(&R);
+    cap_close(&R);
     printf("[R%u] shutdown\n", R.self_id);
     return 0;
-}
\ No newline at end of file
+}
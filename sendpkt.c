@@ -1,12 +1,14 @@
 #include "common.h"
 
-// Usage: sendpkt <router_ctrl_port> <src_ip> <dst_ip> <ttl> <msg...>
+// Usage: sendpkt [router_ip:]<router_ctrl_port> <src_ip> <dst_ip> <ttl> <msg...>
+// router_ip defaults to loopback.
 int main(int argc,char** argv){
     if(argc<6){
-        fprintf(stderr,"Usage: %s <router_ctrl_port> <src_ip> <dst_ip> <ttl> <msg...>\n", argv[0]);
+        fprintf(stderr,"Usage: %s [router_ip:]<router_ctrl_port> <src_ip> <dst_ip> <ttl> <msg...>\n", argv[0]);
         return 1;
     }
-    uint16_t ctrl = (uint16_t)atoi(argv[1]);
+    uint32_t router_ip; uint16_t ctrl;
+    if(!parse_endpoint(argv[1], &router_ip, &ctrl)){ fprintf(stderr,"bad router address\n"); return 2; }
     uint16_t data_port = get_data_port(ctrl);
 
     struct in_addr a;
@@ -26,7 +28,7 @@ int main(int argc,char** argv){
 
     int s=socket(AF_INET,SOCK_DGRAM,0); if(s<0){perror("socket"); return 3;}
     struct sockaddr_in to={0}; to.sin_family=AF_INET;
-    to.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+    to.sin_addr.s_addr=router_ip;
     to.sin_port=htons(data_port);
 
     data_msg_t p={0}; p.type=MSG_DATA; p.ttl=ttl;
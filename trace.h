@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// -----------------------------------------------------------------------------
+// Static tracepoints (USDT, provider "router")
+// -----------------------------------------------------------------------------
+// Each TRACE_* macro is a USDT probe: a single nop in the instruction stream
+// plus an ELF note describing its arguments, so it costs nothing until a
+// tracer (bpftrace, perf, systemtap) attaches. The scripts in scripts/ use
+// them; list them with:  bpftrace -l 'usdt:./router:*'
+//
+// Probes need <sys/sdt.h> (package systemtap-sdt-dev / systemtap-sdt-devel).
+// Without it, or with -DNO_USDT, the macros compile to nothing. The Makefile
+// checks for the header and says so when it builds the probes out.
+//
+// Probe                 Arguments
+// pkt_recv              dst_ip, src_ip, ttl, len
+// lpm_result            dst_ip, route net (0 = no match), mask, next_hop
+// pkt_forward           dst_ip, next_hop, cost, ttl
+// pkt_deliver           dst_ip, ttl
+// pkt_drop              dst_ip, reason (TRACE_DROP_*)
+// dv_recv               sender ip, sender ctrl port, entries, bytes
+// dv_entry              net, mask, sender ip, advertised cost, changed (0/1)
+// dv_applied            sender ip, changed (0/1)
+// recompute_start       routes
+// route_change          net, mask, next_hop, old cost, new cost
+// recompute_done        routes changed
+// neighbor_dead         ip, ctrl port
+//
+// IPs, nets and masks are in network byte order, as in the routing table.
+// -----------------------------------------------------------------------------
+enum { TRACE_DROP_TTL = 1, TRACE_DROP_NO_MATCH = 2, TRACE_DROP_NEXT_HOP_DOWN = 3 };
+
+#if !defined(NO_USDT) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define HAVE_USDT 1
+#  endif
+#endif
+
+#ifdef HAVE_USDT
+#define TRACE_PKT_RECV(dst, src, ttl, len)      DTRACE_PROBE4(router, pkt_recv, dst, src, ttl, len)
+#define TRACE_LPM_RESULT(dst, net, mask, nh)    DTRACE_PROBE4(router, lpm_result, dst, net, mask, nh)
+#define TRACE_PKT_FORWARD(dst, nh, cost, ttl)   DTRACE_PROBE4(router, pkt_forward, dst, nh, cost, ttl)
+#define TRACE_PKT_DELIVER(dst, ttl)             DTRACE_PROBE2(router, pkt_deliver, dst, ttl)
+#define TRACE_PKT_DROP(dst, reason)             DTRACE_PROBE2(router, pkt_drop, dst, reason)
+#define TRACE_DV_RECV(ip, port, num, len)       DTRACE_PROBE4(router, dv_recv, ip, port, num, len)
+#define TRACE_DV_ENTRY(net, mask, ip, cost, ch) DTRACE_PROBE5(router, dv_entry, net, mask, ip, cost, ch)
+#define TRACE_DV_APPLIED(ip, changed)           DTRACE_PROBE2(router, dv_applied, ip, changed)
+#define TRACE_RECOMPUTE_START(routes)           DTRACE_PROBE1(router, recompute_start, routes)
+#define TRACE_ROUTE_CHANGE(net, mask, nh, o, n) DTRACE_PROBE5(router, route_change, net, mask, nh, o, n)
+#define TRACE_RECOMPUTE_DONE(changed)           DTRACE_PROBE1(router, recompute_done, changed)
+#define TRACE_NEIGHBOR_DEAD(ip, port)           DTRACE_PROBE2(router, neighbor_dead, ip, port)
+#else
+#define TRACE_PKT_RECV(dst, src, ttl, len)      do {} while (0)
+#define TRACE_LPM_RESULT(dst, net, mask, nh)    do {} while (0)
+#define TRACE_PKT_FORWARD(dst, nh, cost, ttl)   do {} while (0)
+#define TRACE_PKT_DELIVER(dst, ttl)             do {} while (0)
+#define TRACE_PKT_DROP(dst, reason)             do {} while (0)
+#define TRACE_DV_RECV(ip, port, num, len)       do {} while (0)
+#define TRACE_DV_ENTRY(net, mask, ip, cost, ch) do {} while (0)
+#define TRACE_DV_APPLIED(ip, changed)           do {} while (0)
+#define TRACE_RECOMPUTE_START(routes)           do {} while (0)
+#define TRACE_ROUTE_CHANGE(net, mask, nh, o, n) do {} while (0)
+#define TRACE_RECOMPUTE_DONE(changed)           do {} while (0)
+#define TRACE_NEIGHBOR_DEAD(ip, port)           do {} while (0)
+#endif
+
+#endif // TRACE_H
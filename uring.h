@@ -0,0 +1,204 @@
+#ifndef URING_H
+#define URING_H
+
+// -----------------------------------------------------------------------------
+// Minimal io_uring wrapper
+// -----------------------------------------------------------------------------
+// Just enough of the io_uring interface for the router's optional I/O backend:
+// ring setup, SQE allocation, batched submit+wait, CQE iteration and one
+// provided-buffer ring for multishot receives. It talks to the kernel with raw
+// syscalls so the build does not depend on liburing.
+//
+// HAVE_URING is 0 when the kernel headers are too old for multishot receive
+// (Linux 6.0); the router then only offers the select() backend.
+// -----------------------------------------------------------------------------
+#if defined(__linux__) && defined(__has_include)
+#  if __has_include(<linux/io_uring.h>)
+#    include <linux/io_uring.h>
+#  endif
+#endif
+
+#ifdef IORING_RECV_MULTISHOT
+#define HAVE_URING 1
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+typedef struct {
+    int fd;                      // Ring file descriptor
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    unsigned sq_entries;
+    unsigned sq_pending;         // SQEs filled in but not yet handed to the kernel
+    void*  sq_ring; size_t sq_ring_sz;
+    void*  cq_ring; size_t cq_ring_sz;
+    size_t sqes_sz;
+} uring_t;
+
+// Provided-buffer ring: nbufs buffers of buf_size bytes, group id bgid
+typedef struct {
+    struct io_uring_buf_ring* br;
+    size_t   br_sz;
+    uint8_t* mem;
+    unsigned nbufs, buf_size;
+    uint16_t bgid;
+} uring_bufs_t;
+
+static inline int uring_setup(unsigned entries, struct io_uring_params* p){
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags){
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Create a ring with the given number of SQ entries. Returns 0 or -errno.
+static inline int uring_init(uring_t* u, unsigned entries){
+    // SUBMIT_ALL: an SQE that fails at submission must not hold back the
+    // ones queued behind it (the timeout, other receives, sends)
+    struct io_uring_params p = { .flags = IORING_SETUP_SUBMIT_ALL };
+    memset(u, 0, sizeof(*u));
+    int fd = uring_setup(entries, &p);
+    if (fd < 0) return -errno;
+
+    u->sq_ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_ring_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (u->cq_ring_sz > u->sq_ring_sz) u->sq_ring_sz = u->cq_ring_sz;
+        u->cq_ring_sz = u->sq_ring_sz;
+    }
+    u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (u->sq_ring == MAP_FAILED) goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ring = u->sq_ring;
+    } else {
+        u->cq_ring = mmap(NULL, u->cq_ring_sz, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (u->cq_ring == MAP_FAILED) goto fail;
+    }
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) goto fail;
+
+    uint8_t* sq = u->sq_ring;
+    uint8_t* cq = u->cq_ring;
+    u->sq_head  = (unsigned*)(sq + p.sq_off.head);
+    u->sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+    u->sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+    u->sq_array = (unsigned*)(sq + p.sq_off.array);
+    u->cq_head  = (unsigned*)(cq + p.cq_off.head);
+    u->cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+    u->cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+    u->cqes     = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    u->sq_entries = p.sq_entries;
+    u->fd = fd;
+    return 0;
+
+fail:;
+    int err = -errno;
+    if (u->sq_ring && u->sq_ring != MAP_FAILED) munmap(u->sq_ring, u->sq_ring_sz);
+    if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+        munmap(u->cq_ring, u->cq_ring_sz);
+    close(fd);
+    return err;
+}
+
+static inline void uring_exit(uring_t* u){
+    munmap(u->sqes, u->sqes_sz);
+    if (u->cq_ring != u->sq_ring) munmap(u->cq_ring, u->cq_ring_sz);
+    munmap(u->sq_ring, u->sq_ring_sz);
+    close(u->fd);
+}
+
+// Next free SQE (zeroed), or NULL if the submission queue is full
+static inline struct io_uring_sqe* uring_get_sqe(uring_t* u){
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    unsigned tail = *u->sq_tail + u->sq_pending;
+    if (tail - head >= u->sq_entries) return NULL;
+
+    unsigned idx = tail & *u->sq_mask;
+    struct io_uring_sqe* sqe = &u->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    u->sq_array[idx] = idx;
+    u->sq_pending++;
+    return sqe;
+}
+
+// Hand all pending SQEs to the kernel in one syscall and optionally wait for
+// at least wait_nr completions. Returns the io_uring_enter() result or -errno.
+static inline int uring_submit(uring_t* u, unsigned wait_nr){
+    unsigned n = u->sq_pending;
+    if (n) {
+        __atomic_store_n(u->sq_tail, *u->sq_tail + n, __ATOMIC_RELEASE);
+        u->sq_pending = 0;
+    }
+    if (!n && !wait_nr) return 0;
+    int r = uring_enter(u->fd, n, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0);
+    return r < 0 ? -errno : r;
+}
+
+// Next completion, or NULL if none is ready. Release it with uring_cqe_seen().
+static inline struct io_uring_cqe* uring_peek_cqe(uring_t* u){
+    unsigned head = *u->cq_head;
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) return NULL;
+    return &u->cqes[head & *u->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring_t* u){
+    __atomic_store_n(u->cq_head, *u->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+// Hand buffer bid back to the kernel for the next receive
+static inline void uring_buf_recycle(uring_bufs_t* b, uint16_t bid){
+    unsigned tail = b->br->tail;
+    struct io_uring_buf* e = &b->br->bufs[tail & (b->nbufs - 1)];
+    e->addr = (uint64_t)(uintptr_t)(b->mem + (size_t)bid * b->buf_size);
+    e->len = b->buf_size;
+    e->bid = bid;
+    __atomic_store_n(&b->br->tail, (uint16_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+static inline uint8_t* uring_buf_addr(uring_bufs_t* b, uint16_t bid){
+    return b->mem + (size_t)bid * b->buf_size;
+}
+
+// Register a provided-buffer ring (nbufs must be a power of two). Returns 0 or -errno.
+static inline int uring_bufs_init(uring_t* u, uring_bufs_t* b, uint16_t bgid,
+                                  unsigned nbufs, unsigned buf_size){
+    memset(b, 0, sizeof(*b));
+    b->br_sz = nbufs * sizeof(struct io_uring_buf);
+    b->br = mmap(NULL, b->br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (b->br == MAP_FAILED) return -errno;
+    b->mem = malloc((size_t)nbufs * buf_size);
+    if (!b->mem) { munmap(b->br, b->br_sz); return -ENOMEM; }
+
+    struct io_uring_buf_reg reg = { .ring_addr = (uint64_t)(uintptr_t)b->br,
+                                    .ring_entries = nbufs, .bgid = bgid };
+    if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int err = -errno;
+        free(b->mem);
+        munmap(b->br, b->br_sz);
+        return err;
+    }
+    b->nbufs = nbufs;
+    b->buf_size = buf_size;
+    b->bgid = bgid;
+    for (unsigned i = 0; i < nbufs; i++) uring_buf_recycle(b, (uint16_t)i);
+    return 0;
+}
+
+static inline void uring_bufs_free(uring_bufs_t* b){
+    free(b->mem);
+    munmap(b->br, b->br_sz);
+}
+
+#else
+#define HAVE_URING 0
+#endif
+
+#endif // URING_H